@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+// A snapshot of the process's memory use. Where this can't be determined
+// on the current platform, available is false and the sizes are zero.
+struct MemorySample {
+    bool available;
+    long rss_kb;
+    // The high-water mark of the resident set size since it was last reset.
+    long peak_rss_kb;
+};
+
+// A completed phase of compilation, as recorded by a ScopedTimer.
+struct TraceEvent {
+    std::string name;
+    std::string category;
+    // The module (or imported module) this phase was working on, if any.
+    std::string module;
+    long start_us;
+    long duration_us;
+    // Whether the memory figures below could be measured.
+    bool memory_available;
+    // The largest resident set size the process reached during the phase,
+    // including memory that was allocated and freed again within it.
+    long peak_rss_kb;
+    // How much the resident set size grew (or shrank, if negative) between
+    // the start and the end of the phase.
+    long rss_growth_kb;
+};
+
+// Collects timed phases of a compiler run and writes them out in the
+// Chrome trace_event format, which can be loaded into chrome://tracing
+// or any of the other tools that understand it.
+//
+// Recording is cheap but not free, so a disabled recorder ignores
+// everything and ScopedTimer won't even read the clock. When enabled,
+// each timer reads /proc/self/status twice and writes to
+// /proc/self/clear_refs once. A timer keeps its own samples out of its
+// duration, but a nested timer's samples fall within its parent's, so
+// many short nested phases will inflate their parents slightly.
+class TraceRecorder {
+  public:
+    bool enabled;
+    std::vector<TraceEvent> events;
+
+    TraceRecorder() : enabled(false), origin(std::chrono::steady_clock::now()) {}
+
+    long now_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - this->origin
+        ).count();
+    }
+
+    static MemorySample sample_memory() {
+        MemorySample sample;
+        sample.available = false;
+        sample.rss_kb = 0;
+        sample.peak_rss_kb = 0;
+#if defined(__linux__)
+        FILE * status = fopen("/proc/self/status", "r");
+        if (!status) {
+            return sample;
+        }
+        bool found_rss = false;
+        bool found_peak = false;
+        char line[256];
+        while (fgets(line, sizeof(line), status)) {
+            if (strncmp(line, "VmRSS:", 6) == 0) {
+                found_rss = sscanf(&line[6], "%ld", &sample.rss_kb) == 1;
+            }
+            else if (strncmp(line, "VmHWM:", 6) == 0) {
+                found_peak = sscanf(&line[6], "%ld", &sample.peak_rss_kb) == 1;
+            }
+        }
+        fclose(status);
+        sample.available = found_rss && found_peak;
+#endif
+        return sample;
+    }
+
+    // Resets the high-water mark reported by sample_memory() to the
+    // current resident set size. Returns false if that isn't possible.
+    static bool reset_peak_memory() {
+#if defined(__linux__)
+        FILE * clear_refs = fopen("/proc/self/clear_refs", "w");
+        if (!clear_refs) {
+            return false;
+        }
+        // Writing 5 resets only the peak RSS, leaving page state alone.
+        bool ok = fputs("5", clear_refs) >= 0;
+        return (fclose(clear_refs) == 0) && ok;
+#else
+        return false;
+#endif
+    }
+
+    // Called by ScopedTimer as a phase starts, returning the memory use
+    // at the start of the phase.
+    MemorySample begin_phase() {
+        MemorySample sample = sample_memory();
+        if (!this->open_peaks.empty()) {
+            // Resetting the high-water mark below would lose the peak
+            // the enclosing phase has reached so far, so keep it here.
+            this->open_peaks.back() = std::max(this->open_peaks.back(), sample.peak_rss_kb);
+        }
+        if (!reset_peak_memory()) {
+            // Without the reset we'd only see the process-wide peak.
+            sample.available = false;
+        }
+        this->open_peaks.push_back(sample.rss_kb);
+        return sample;
+    }
+
+    // Called by ScopedTimer as a phase ends, returning the phase's peak.
+    long end_phase(const MemorySample& end) {
+        long peak = std::max(this->open_peaks.back(), end.peak_rss_kb);
+        this->open_peaks.pop_back();
+        if (!this->open_peaks.empty()) {
+            this->open_peaks.back() = std::max(this->open_peaks.back(), peak);
+        }
+        return peak;
+    }
+
+    void record(const TraceEvent& event) {
+        if (this->enabled) {
+            this->events.push_back(event);
+        }
+    }
+
+    void write_json(std::ostream& out) const {
+        out << "{\"traceEvents\":[";
+        for (size_t i = 0; i < this->events.size(); i++) {
+            const TraceEvent& event = this->events[i];
+            if (i > 0) {
+                out << ",";
+            }
+            out << "\n{\"name\":";
+            write_json_string(out, event.name);
+            out << ",\"cat\":";
+            write_json_string(out, event.category);
+            // "X" is a "complete" event, with both a start and a duration.
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":1";
+            out << ",\"ts\":" << event.start_us;
+            out << ",\"dur\":" << event.duration_us;
+            out << ",\"args\":{\"module\":";
+            write_json_string(out, event.module);
+            if (event.memory_available) {
+                out << ",\"peak_rss_kb\":" << event.peak_rss_kb;
+                out << ",\"rss_growth_kb\":" << event.rss_growth_kb;
+            }
+            out << "}}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+  private:
+    std::chrono::steady_clock::time_point origin;
+    // The peak so far of each phase that's currently open, innermost last.
+    std::vector<long> open_peaks;
+
+    static void write_json_string(std::ostream& out, const std::string& str) {
+        const char * hex = "0123456789abcdef";
+        out << '"';
+        for (size_t i = 0; i < str.size(); i++) {
+            unsigned char c = str[i];
+            switch (c) {
+                case '"':
+                    out << "\\\"";
+                    break;
+                case '\\':
+                    out << "\\\\";
+                    break;
+                case '\n':
+                    out << "\\n";
+                    break;
+                default:
+                    if (c < 0x20) {
+                        out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+                    }
+                    else {
+                        out << c;
+                    }
+            }
+        }
+        out << '"';
+    }
+};
+
+// Records the time between its construction and destruction as a phase
+// in the given recorder. Timers can be nested to break a phase down,
+// e.g. a per-module timer containing lexing and parsing timers.
+class ScopedTimer {
+  public:
+    TraceRecorder& recorder;
+    TraceEvent event;
+    MemorySample start_memory;
+
+    ScopedTimer(TraceRecorder& recorder_, const std::string& name, const std::string& category, const std::string& module = "") : recorder(recorder_) {
+        if (this->recorder.enabled) {
+            this->event.name = name;
+            this->event.category = category;
+            this->event.module = module;
+            // Sample memory before starting the clock, and stop the clock
+            // before sampling again, so the sampling isn't timed.
+            this->start_memory = this->recorder.begin_phase();
+            this->event.start_us = this->recorder.now_us();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (this->recorder.enabled) {
+            this->event.duration_us = this->recorder.now_us() - this->event.start_us;
+            MemorySample end_memory = TraceRecorder::sample_memory();
+            this->event.peak_rss_kb = this->recorder.end_phase(end_memory);
+            this->event.rss_growth_kb = end_memory.rss_kb - this->start_memory.rss_kb;
+            this->event.memory_available = this->start_memory.available && end_memory.available;
+            this->recorder.record(this->event);
+        }
+    }
+};
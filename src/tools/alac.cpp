@@ -1,25 +1,46 @@
 
 #include <alambre/scanner.hpp>
+#include <alambre/trace.hpp>
+#include <fstream>
+#include <string.h>
+#include <vector>
 
-int main(int argc, char **argv) {
+void compile_module(TraceRecorder& tracer, const std::string& module_name, const std::string& str) {
+
+    ScopedTimer module_timer(tracer, "compile " + module_name, "module", module_name);
 
     typedef lex::lexertl::token<char const*> token_type;
     typedef lex::lexertl::actor_lexer<token_type> lexer_type;
 
-    alaLexer<lexer_type> lexer;
+    // Tokenize up front, so that the lex phase doesn't include the time
+    // spent printing the tokens below.
+    std::vector<token_type> tokens;
+    bool lexed_ok;
+    {
+        ScopedTimer lex_timer(tracer, "lex", "phase", module_name);
 
-    std::string str("hello\n    hello\n\n    hello\nif hello {\n    hello\n}\n");
-    char const* first = str.c_str();
-    char const* last = &first[str.size()];
+        alaLexer<lexer_type> lexer;
+
+        char const* first = str.c_str();
+        char const* last = &first[str.size()];
+
+        lexer_type::iterator_type iter = lexer.begin(first, last);
+        lexer_type::iterator_type end = lexer.end();
 
-    lexer_type::iterator_type iter = lexer.begin(first, last);
-    lexer_type::iterator_type end = lexer.end();
+        while (iter != end && token_is_valid(*iter)) {
+            tokens.push_back(*iter);
+            ++iter;
+        }
+
+        lexed_ok = (iter == end);
+    }
 
-    while (iter != end && token_is_valid(*iter)) {
-        unsigned int token_id = (*iter).id();
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const token_type& token = tokens[i];
+        unsigned int token_id = token.id();
         switch (token_id) {
             case TOK_IDENT:
-                cout << "Ident: " << (*iter).value() << "\n";
+                cout << "Ident: " << token.value() << "\n";
                 break;
             case TOK_INDENT:
                 cout << "Indent\n";
@@ -29,17 +50,43 @@ int main(int argc, char **argv) {
                 break;
             default:
                 if (token_id < 128) {
-                    cout << "Punctuation: " << (*iter).value() << "\n";
+                    cout << "Punctuation: " << token.value() << "\n";
                 }
                 else {
-                    cout << "Token type " << token_id << ": " << (*iter).value() << "\n";
+                    cout << "Token type " << token_id << ": " << token.value() << "\n";
                 }
         }
-        ++iter;
     }
 
-    if (iter != end) {
+    if (!lexed_ok) {
         cout << "Something went wrong :(\n";
     }
 
 }
+
+int main(int argc, char **argv) {
+
+    // --trace=FILE writes a Chrome trace_event file showing how long
+    // each phase of compilation took.
+    TraceRecorder tracer;
+    const char * trace_filename = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_filename = &argv[i][8];
+            tracer.enabled = true;
+        }
+    }
+
+    std::string str("hello\n    hello\n\n    hello\nif hello {\n    hello\n}\n");
+    compile_module(tracer, "<builtin>", str);
+
+    if (trace_filename) {
+        std::ofstream trace_file(trace_filename);
+        if (!trace_file) {
+            cerr << "Failed to open trace file " << trace_filename << "\n";
+            return 1;
+        }
+        tracer.write_json(trace_file);
+    }
+
+}
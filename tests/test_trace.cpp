@@ -0,0 +1,149 @@
+
+#include <alambre/trace.hpp>
+#include "gtest/gtest.h"
+#include <sstream>
+#include <string>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+TEST(TestTrace, DisabledRecordsNothing) {
+    TraceRecorder tracer;
+
+    {
+        ScopedTimer timer(tracer, "lex", "phase", "buses.spi");
+    }
+
+    ASSERT_EQ(0u, tracer.events.size());
+}
+
+TEST(TestTrace, NestedTimers) {
+    TraceRecorder tracer;
+    tracer.enabled = true;
+
+    {
+        ScopedTimer module_timer(tracer, "compile buses.spi", "module", "buses.spi");
+        {
+            ScopedTimer lex_timer(tracer, "lex", "phase", "buses.spi");
+        }
+    }
+
+    // Inner timers finish first, so they're recorded first.
+    ASSERT_EQ(2u, tracer.events.size());
+    EXPECT_EQ("lex", tracer.events[0].name);
+    EXPECT_EQ("compile buses.spi", tracer.events[1].name);
+    EXPECT_EQ("buses.spi", tracer.events[1].module);
+    EXPECT_LE(tracer.events[1].start_us, tracer.events[0].start_us);
+    EXPECT_GE(tracer.events[1].duration_us, tracer.events[0].duration_us);
+}
+
+// Makes size bytes resident and then releases them again. This maps
+// the memory directly rather than going through malloc, which might
+// otherwise keep the pages resident for reuse after they're freed.
+static void touch_and_release(size_t size) {
+#if defined(__linux__)
+    char * buffer = (char *) mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, (void *) buffer);
+    memset(buffer, 1, size);
+    munmap(buffer, size);
+#else
+    (void) size;
+#endif
+}
+
+TEST(TestTrace, PeakMemory) {
+    if (!TraceRecorder::sample_memory().available || !TraceRecorder::reset_peak_memory()) {
+        GTEST_SKIP() << "Memory use can't be measured on this platform";
+    }
+
+    TraceRecorder tracer;
+    tracer.enabled = true;
+
+    MemorySample before = TraceRecorder::sample_memory();
+    {
+        ScopedTimer timer(tracer, "parse", "phase", "buses.spi");
+        touch_and_release(16 * 1024 * 1024);
+    }
+
+    // The memory was freed again before the phase ended, but it should
+    // still count towards the phase's peak.
+    ASSERT_EQ(1u, tracer.events.size());
+    EXPECT_TRUE(tracer.events[0].memory_available);
+    EXPECT_GE(tracer.events[0].peak_rss_kb, before.rss_kb + 8 * 1024);
+    EXPECT_LT(tracer.events[0].rss_growth_kb, 8 * 1024);
+}
+
+TEST(TestTrace, NestedPeakMemory) {
+    if (!TraceRecorder::sample_memory().available || !TraceRecorder::reset_peak_memory()) {
+        GTEST_SKIP() << "Memory use can't be measured on this platform";
+    }
+
+    TraceRecorder tracer;
+    tracer.enabled = true;
+
+    MemorySample before = TraceRecorder::sample_memory();
+    {
+        ScopedTimer module_timer(tracer, "compile buses.spi", "module", "buses.spi");
+        touch_and_release(16 * 1024 * 1024);
+        // Starting this timer resets the process's high-water mark, but
+        // the enclosing phase must still remember the peak it reached.
+        ScopedTimer lex_timer(tracer, "lex", "phase", "buses.spi");
+    }
+
+    ASSERT_EQ(2u, tracer.events.size());
+    EXPECT_LT(tracer.events[0].peak_rss_kb, before.rss_kb + 8 * 1024);
+    EXPECT_GE(tracer.events[1].peak_rss_kb, before.rss_kb + 8 * 1024);
+}
+
+TEST(TestTrace, WriteJson) {
+    TraceRecorder tracer;
+    tracer.enabled = true;
+
+    TraceEvent event;
+    event.name = "import \"util.delay\"";
+    event.category = "import";
+    event.module = "buses.spi";
+    event.start_us = 10;
+    event.duration_us = 25;
+    event.memory_available = true;
+    event.peak_rss_kb = 2048;
+    event.rss_growth_kb = -12;
+    tracer.record(event);
+
+    std::ostringstream out;
+    tracer.write_json(out);
+
+    const char * expected = R"({"traceEvents":[
+{"name":"import \"util.delay\"","cat":"import","ph":"X","pid":1,"tid":1,"ts":10,"dur":25,"args":{"module":"buses.spi","peak_rss_kb":2048,"rss_growth_kb":-12}}
+],"displayTimeUnit":"ms"}
+)";
+
+    ASSERT_EQ(std::string(expected), out.str());
+}
+
+TEST(TestTrace, WriteJsonWithoutMemory) {
+    TraceRecorder tracer;
+    tracer.enabled = true;
+
+    TraceEvent event;
+    event.name = "lex";
+    event.category = "phase";
+    event.module = "buses.spi";
+    event.start_us = 10;
+    event.duration_us = 25;
+    event.memory_available = false;
+    event.peak_rss_kb = 0;
+    event.rss_growth_kb = 0;
+    tracer.record(event);
+
+    std::ostringstream out;
+    tracer.write_json(out);
+
+    const char * expected = R"({"traceEvents":[
+{"name":"lex","cat":"phase","ph":"X","pid":1,"tid":1,"ts":10,"dur":25,"args":{"module":"buses.spi"}}
+],"displayTimeUnit":"ms"}
+)";
+
+    ASSERT_EQ(std::string(expected), out.str());
+}